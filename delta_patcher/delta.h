@@ -0,0 +1,305 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Delta format, every number is an unsigned LEB128 varint:
+//
+//   "SDLT" <version> <source size> <source hash> <target size> <target hash>
+//   <op>...
+//   END
+//
+// The target is rebuilt front to back, each op appending to it:
+//
+//   COPY <source offset> <length>: copy bytes from the source
+//   ADD <length> <bytes>: copy bytes from the delta itself
+//   COPY_ADJUST <source offset> <count> <stride> <field> <addend> <big endian>:
+//       copy count records of stride bytes from the source, adding addend (mod 2^32) to the 32 bits integer at field
+//       in each record. This is used for tables of offsets where every entry after an edit is shifted by the same amount.
+//
+// The hashes are FNV-1a 64 of the whole files, so applying a delta to the wrong source is detected.
+
+constexpr char delta_magic[] = "SDLT";
+constexpr uint64_t delta_version = 1;
+
+enum DELTA_OP_TYPE : uint8_t {
+    DELTA_END = 0,
+    DELTA_COPY = 1,
+    DELTA_ADD = 2,
+    DELTA_COPY_ADJUST = 3,
+};
+
+class delta_hash_t {
+public:
+    uint64_t value = 0xcbf29ce484222325ull;
+
+    void update(const char* data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            value ^= static_cast<unsigned char>(data[i]);
+            value *= 0x100000001b3ull;
+        }
+    }
+};
+
+inline uint64_t delta_hash(const char* data, size_t size) {
+    delta_hash_t h;
+    h.update(data, size);
+    return h.value;
+}
+
+inline void delta_adjust_records(char* data, size_t count, size_t stride, size_t field, uint32_t addend, bool big_endian) {
+    for (size_t i = 0; i < count; i++) {
+        unsigned char* x = reinterpret_cast<unsigned char*>(data + i * stride + field);
+        uint32_t value = 0;
+        for (size_t j = 0; j < 4; j++) value |= uint32_t(x[big_endian ? j : 3 - j]) << ((3 - j) * 8);
+        value += addend;
+        for (size_t j = 0; j < 4; j++) x[big_endian ? j : 3 - j] = (value >> ((3 - j) * 8)) & 255;
+    }
+}
+
+class delta_writer_t {
+private:
+    const char* source;
+    size_t source_size;
+
+    std::string ops;
+    size_t pending_copy_offset = 0;
+    size_t pending_copy_length = 0;
+    std::string pending_add;
+
+    // a copy costs a few bytes, so matching runs shorter than this are cheaper as part of an add
+    static constexpr size_t min_copy_length = 8;
+
+    void put(uint64_t x) {
+        while (x >= 128) {
+            ops += char((x & 127) | 128);
+            x >>= 7;
+        }
+        ops += char(x);
+    }
+
+    void flush() {
+        if (pending_copy_length) {
+            put(DELTA_COPY);
+            put(pending_copy_offset);
+            put(pending_copy_length);
+            pending_copy_length = 0;
+        }
+        if (!pending_add.empty()) {
+            put(DELTA_ADD);
+            put(pending_add.size());
+            ops += pending_add;
+            pending_add.clear();
+        }
+    }
+
+public:
+    delta_writer_t(const char* source, size_t source_size) : source(source), source_size(source_size) {}
+
+    void copy(size_t source_offset, size_t length) {
+        if (length == 0) return;
+        assert(source_offset + length <= source_size);
+        if (pending_copy_length && (pending_copy_offset + pending_copy_length == source_offset)) {
+            pending_copy_length += length;
+            return;
+        }
+        flush();
+        pending_copy_offset = source_offset;
+        pending_copy_length = length;
+    }
+
+    void add(const char* data, size_t length) {
+        if (length == 0) return;
+        if (pending_copy_length) flush();
+        pending_add.append(data, length);
+    }
+
+    void copy_adjust(size_t source_offset, size_t count, size_t stride, size_t field, uint32_t addend, bool big_endian) {
+        if (count == 0) return;
+        if (addend == 0) return copy(source_offset, count * stride);
+        assert(source_offset + count * stride <= source_size);
+        flush();
+        put(DELTA_COPY_ADJUST);
+        put(source_offset);
+        put(count);
+        put(stride);
+        put(field);
+        put(addend);
+        put(big_endian);
+    }
+
+    // append target[0, length), copying the parts that are the same as the source starting at source_offset
+    void diff(size_t source_offset, const char* target, size_t length) {
+        size_t i = 0;
+        while (i < length) {
+            size_t j = i;
+            while ((j < length) && (source_offset + j < source_size) && (source[source_offset + j] == target[j])) j++;
+            if (j - i >= min_copy_length) copy(source_offset + i, j - i);
+            else add(target + i, j - i);
+            i = j;
+            while ((j < length) && ((source_offset + j >= source_size) || (source[source_offset + j] != target[j]))) j++;
+            add(target + i, j - i);
+            i = j;
+        }
+    }
+
+    void save(const std::string& path, const char* target, size_t target_size) {
+        flush();
+        put(DELTA_END);
+        std::string header = delta_magic;
+        std::swap(header, ops);
+        put(delta_version);
+        put(source_size);
+        put(delta_hash(source, source_size));
+        put(target_size);
+        put(delta_hash(target, target_size));
+        std::swap(header, ops);
+
+        std::fstream f(path, std::ios::out | std::ios::binary);
+        if (!f) {
+            std::cerr << "failed to write to file: " << path << '\n';
+            exit(-1);
+        }
+        f.write(header.data(), header.size());
+        f.write(ops.data(), ops.size());
+        if (!f) {
+            std::cerr << "failed to write to file: " << path << '\n';
+            exit(-1);
+        }
+        f.close();
+        std::cerr << "delta size: " << header.size() + ops.size() << ", output size: " << target_size << '\n';
+    }
+};
+
+// rebuild the target by streaming through the delta, only a fixed size buffer is kept in memory
+// the target is written to <target>.tmp and only moved into place once it's verified, so the target can be the source
+inline void apply_delta(const std::string& source_path, const std::string& delta_path, const std::string& target_path) {
+    constexpr size_t chunk_size = 1 << 20;
+    const std::string temp_path = target_path + ".tmp";
+    std::fstream target_file;
+    bool has_temp_file = false;
+    auto fail = [&](const std::string& message) {
+        std::cerr << "Error: " << message << '\n';
+        if (has_temp_file) {
+            target_file.close();
+            std::remove(temp_path.c_str());
+        }
+        exit(-1);
+    };
+
+    std::fstream delta_file(delta_path, std::ios::in | std::ios::binary);
+    if (!delta_file) fail("failed to read delta: " + delta_path);
+    auto get = [&]() {
+        uint64_t x = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            int byte = delta_file.get();
+            if (byte == EOF) fail("truncated delta");
+            x |= uint64_t(byte & 127) << shift;
+            if (byte < 128) return x;
+        }
+        fail("bad varint in delta");
+        return x;
+    };
+    {
+        char header[4];
+        delta_file.read(header, 4);
+        if ((!delta_file) || (std::string(header, 4) != delta_magic)) fail("not a delta file: " + delta_path);
+        if (get() != delta_version) fail("unsupported delta version");
+    }
+    const uint64_t source_size = get();
+    const uint64_t source_hash = get();
+    const uint64_t target_size = get();
+    const uint64_t target_hash = get();
+
+    std::vector<char> buffer(chunk_size);
+    std::fstream source_file(source_path, std::ios::in | std::ios::binary);
+    if (!source_file) fail("failed to read source: " + source_path);
+    {
+        delta_hash_t h;
+        uint64_t size = 0;
+        while (source_file) {
+            source_file.read(buffer.data(), buffer.size());
+            h.update(buffer.data(), source_file.gcount());
+            size += source_file.gcount();
+        }
+        source_file.clear();
+        if ((size != source_size) || (h.value != source_hash)) fail("source doesn't match the one the delta was made from");
+    }
+
+    target_file.open(temp_path, std::ios::out | std::ios::binary);
+    if (!target_file) fail("failed to write to file: " + temp_path);
+    has_temp_file = true;
+    delta_hash_t h;
+    uint64_t size = 0;
+    auto emit = [&](const char* data, size_t length) {
+        target_file.write(data, length);
+        h.update(data, length);
+        size += length;
+    };
+    auto read_source = [&](uint64_t offset, uint64_t length) {
+        if ((offset > source_size) || (length > source_size - offset)) fail("delta reads past the end of source");
+        source_file.seekg(offset, source_file.beg);
+        source_file.read(buffer.data(), length);
+        if (!source_file) fail("failed to read source: " + source_path);
+    };
+
+    while (true) {
+        const uint64_t op = get();
+        if (op == DELTA_END) break;
+        if (op == DELTA_COPY) {
+            uint64_t offset = get();
+            uint64_t length = get();
+            while (length) {
+                const uint64_t part = std::min<uint64_t>(length, chunk_size);
+                read_source(offset, part);
+                emit(buffer.data(), part);
+                offset += part;
+                length -= part;
+            }
+        } else if (op == DELTA_ADD) {
+            uint64_t length = get();
+            while (length) {
+                const uint64_t part = std::min<uint64_t>(length, chunk_size);
+                delta_file.read(buffer.data(), part);
+                if (!delta_file) fail("truncated delta");
+                emit(buffer.data(), part);
+                length -= part;
+            }
+        } else if (op == DELTA_COPY_ADJUST) {
+            uint64_t offset = get();
+            uint64_t count = get();
+            const uint64_t stride = get();
+            const uint64_t field = get();
+            const uint32_t addend = get();
+            const bool big_endian = get();
+            if ((stride < 4) || (stride > chunk_size) || (field > stride - 4)) fail("bad record layout in delta");
+            if (count > source_size / stride) fail("delta reads past the end of source");
+            const uint64_t records_per_chunk = chunk_size / stride;
+            while (count) {
+                const uint64_t part = std::min(count, records_per_chunk);
+                read_source(offset, part * stride);
+                delta_adjust_records(buffer.data(), part, stride, field, addend, big_endian);
+                emit(buffer.data(), part * stride);
+                offset += part * stride;
+                count -= part;
+            }
+        } else {
+            fail("unknown op in delta: " + std::to_string(op));
+        }
+    }
+    target_file.close();
+    if (!target_file) fail("failed to write to file: " + temp_path);
+    if ((size != target_size) || (h.value != target_hash)) fail("output doesn't match the expected result");
+    source_file.close();
+    std::error_code error;
+    std::filesystem::rename(temp_path, target_path, error);
+    if (error) fail("failed to move " + temp_path + " to " + target_path + ": " + error.message());
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#include <iostream>
+
+#include "delta.h"
+
+#define STRING_FROM_ARGV(variable)                                             \
+    for (int __i = 1; __i + 1 < argc; __i += 2) {                              \
+        if (std::string(argv[__i]) == "-" #variable) variable = argv[__i + 1]; \
+    }
+
+int main(int argc, char** argv) {
+    std::string i, o, d;
+    STRING_FROM_ARGV(i);
+    STRING_FROM_ARGV(o);
+    STRING_FROM_ARGV(d);
+    if (i.empty()) {
+        std::cerr << "No input file provided!";
+        return -1;
+    }
+    if (d.empty()) {
+        std::cerr << "No delta file provided, use -d";
+        return -1;
+    }
+    if (o.empty()) {
+        std::cerr << "No output file provided, use -o";
+        return -1;
+    }
+    apply_delta(i, d, o);
+}
\ No newline at end of file
@@ -1,28 +1,70 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define ENDIAN_HAS_SSSE3_KERNEL
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ENDIAN_HAS_NEON_KERNEL
+#endif
+
+inline bool is_big_endian_host() {
+    const uint16_t x = 1;
+    return *reinterpret_cast<const unsigned char*>(&x) == 0;
+}
+
 template <typename T>
 T reverse_bytes(const T& x) {
-    constexpr T mask = 255;
-    T result = 0;
-    if constexpr (sizeof(T) == 2) {
-        result |= ((x >> 0) & mask) << (8);
-        result |= ((x >> 8) & mask) << (0);
+    if constexpr (sizeof(T) == 1) {
+        return x;
+    } else if constexpr (sizeof(T) == 2) {
+        return static_cast<T>(__builtin_bswap16(static_cast<uint16_t>(x)));
     } else if constexpr (sizeof(T) == 4) {
-        result |= ((x >> 0) & mask) << (24);
-        result |= ((x >> 8) & mask) << (16);
-        result |= ((x >> 16) & mask) << (8);
-        result |= ((x >> 24) & mask) << (0);
+        return static_cast<T>(__builtin_bswap32(static_cast<uint32_t>(x)));
     } else if constexpr (sizeof(T) == 8) {
-        result |= ((x >> 0) & mask) << (56);
-        result |= ((x >> 8) & mask) << (48);
-        result |= ((x >> 16) & mask) << (40);
-        result |= ((x >> 24) & mask) << (32);
-        result |= ((x >> 32) & mask) << (24);
-        result |= ((x >> 40) & mask) << (16);
-        result |= ((x >> 48) & mask) << (8);
-        result |= ((x >> 56) & mask) << (0);
+        return static_cast<T>(__builtin_bswap64(static_cast<uint64_t>(x)));
     } else {
         return 0;
     }
-    return result;
+}
+
+#if defined(ENDIAN_HAS_SSSE3_KERNEL)
+// built for SSSE3 regardless of the compiler flags, only called after checking the cpu supports it
+__attribute__((target("ssse3"))) inline void reverse_bytes_32_ssse3(uint32_t* data, const size_t count) {
+    const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_shuffle_epi8(x, mask));
+    }
+    for (; i < count; i++) data[i] = __builtin_bswap32(data[i]);
+}
+#elif defined(ENDIAN_HAS_NEON_KERNEL)
+inline void reverse_bytes_32_neon(uint32_t* data, const size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint8_t* x = reinterpret_cast<uint8_t*>(data + i);
+        vst1q_u8(x, vrev32q_u8(vld1q_u8(x)));
+    }
+    for (; i < count; i++) data[i] = __builtin_bswap32(data[i]);
+}
+#endif
+
+// reverse the bytes of every element of an array in place
+// 32 bits elements (the literal table) use pshufb on x86 with SSSE3 and rev32 on arm with NEON, 4 elements at a time
+// everything else is a scalar bswap loop
+template <typename T>
+void reverse_bytes(T* data, const size_t count) {
+    if constexpr (sizeof(T) == 4) {
+#if defined(ENDIAN_HAS_SSSE3_KERNEL)
+        static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+        if (has_ssse3) return reverse_bytes_32_ssse3(reinterpret_cast<uint32_t*>(data), count);
+#elif defined(ENDIAN_HAS_NEON_KERNEL)
+        return reverse_bytes_32_neon(reinterpret_cast<uint32_t*>(data), count);
+#endif
+    }
+    for (size_t i = 0; i < count; i++) data[i] = reverse_bytes(data[i]);
 }
\ No newline at end of file
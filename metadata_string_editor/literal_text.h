@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+
+// string literals in text dumps are escaped so that each one is a single line without tab:
+// '\\', '\t', '\n' and '\r' use the usual escapes, other control characters use "\xHH"
+// everything else, including UTF-8, is written as is
+static void escape_literal(const std::string& s, std::string& out) {
+    static const char hex_chars[] = "0123456789abcdef";
+    for (const char c : s) {
+        const unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '\\') {
+            out += "\\\\";
+        } else if (c == '\t') {
+            out += "\\t";
+        } else if (c == '\n') {
+            out += "\\n";
+        } else if (c == '\r') {
+            out += "\\r";
+        } else if ((byte < 0x20) || (byte == 0x7f)) {
+            out += "\\x";
+            out += hex_chars[byte / 16];
+            out += hex_chars[byte % 16];
+        } else {
+            out += c;
+        }
+    }
+}
+
+static int hex_digit_value(const char c) {
+    if ((c >= '0') && (c <= '9')) return c - '0';
+    if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+    if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+    return -1;
+}
+
+// reverse of escape_literal, return false if the escape sequences are invalid
+static bool unescape_literal(const char* begin, const char* end, std::string& out) {
+    out.clear();
+    out.reserve(end - begin);
+    for (const char* it = begin; it != end; it++) {
+        if (*it != '\\') {
+            out += *it;
+            continue;
+        }
+        if (++it == end) return false;
+        if (*it == '\\') {
+            out += '\\';
+        } else if (*it == 't') {
+            out += '\t';
+        } else if (*it == 'n') {
+            out += '\n';
+        } else if (*it == 'r') {
+            out += '\r';
+        } else if (*it == 'x') {
+            if ((end - it < 3) || (hex_digit_value(it[1]) < 0) || (hex_digit_value(it[2]) < 0)) return false;
+            out += static_cast<char>(hex_digit_value(it[1]) * 16 + hex_digit_value(it[2]));
+            it += 2;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
\ No newline at end of file
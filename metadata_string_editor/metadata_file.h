@@ -1,13 +1,19 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <charconv>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "../delta_patcher/delta.h"
 #include "endian.h"
+#include "literal_text.h"
+#include "parallel.h"
 
 class metadata_file_t {
 private:
@@ -27,10 +33,11 @@ private:
 
     bool is_reversed_order;
 
-    template <typename T>
+    // the byte order is known once the sanity is read, so it's a template parameter instead of a runtime check
+    template <bool reversed, typename T>
     void read(T& x) {
         std::copy(buffer + cursor, buffer + cursor + sizeof(T), reinterpret_cast<char*>(&x));
-        if (is_reversed_order) x = reverse_bytes(x);
+        if constexpr (reversed) x = reverse_bytes(x);
         cursor += sizeof(T);
     }
 
@@ -46,16 +53,16 @@ private:
         }
     }
 
-    template <typename T>
+    template <bool reversed, typename T>
     void write(T x) {
-        if (is_reversed_order) x = reverse_bytes(x);
+        if constexpr (reversed) x = reverse_bytes(x);
         grow_buffer(cursor + sizeof(T));
         std::copy(reinterpret_cast<char*>(&x), reinterpret_cast<char*>(&x) + sizeof(T), buffer + cursor);
         cursor += sizeof(T);
     }
 
     void write(char* source, size_t size) {
-        grow_buffer(cursor + sizeof(size));
+        grow_buffer(cursor + size);
         std::copy(source, source + size, buffer + cursor);
         cursor += size;
     }
@@ -67,6 +74,177 @@ private:
         std::string data;
     };
 
+    template <bool reversed>
+    void load() {
+        read<reversed>(version);                // 4
+        read<reversed>(string_literal_offset);  // 8
+        read<reversed>(string_literal_size);    // c
+        assert(string_literal_size % 8 == 0);
+        string_literal_data_info_offset = cursor;
+        read<reversed>(string_literal_data_offset);  // 10
+        read<reversed>(string_literal_data_size);    // 14
+
+        // the (length, offset) table is read and converted in bulk
+        std::vector<uint32_t> table(string_literal_size / 4);
+        cursor = string_literal_offset;
+        read(reinterpret_cast<char*>(table.data()), string_literal_size);
+        if constexpr (reversed) reverse_bytes(table.data(), table.size());
+
+        string_literals.resize(string_literal_size / 8);
+        for (size_t i = 0; i < string_literals.size(); i++) {
+            auto&& [length, offset, data] = string_literals[i];
+            length = table[i * 2];
+            offset = table[i * 2 + 1];
+            data.resize(length);
+        }
+        for (auto&& [length, offset, data] : string_literals) {
+            cursor = string_literal_data_offset + offset;
+            read(&data[0], length);
+        }
+    }
+
+    template <bool reversed>
+    void store() {
+        // offsets are an exclusive prefix sum of the lengths, done in parallel:
+        // - sum the lengths of each chunk
+        // - scan the chunk sums to get the starting offset of each chunk
+        // - assign the offsets inside each chunk
+        const size_t chunk_count = get_chunk_count(string_literals.size(), 1 << 14);
+        std::vector<size_t> chunk_offsets(chunk_count + 1, 0);
+        parallel_for_chunks(string_literals.size(), chunk_count, [&](size_t chunk, size_t begin, size_t end) {
+            size_t sum = 0;
+            for (size_t i = begin; i < end; i++) sum += string_literals[i].length;
+            chunk_offsets[chunk + 1] = sum;
+        });
+        for (size_t chunk = 0; chunk < chunk_count; chunk++) chunk_offsets[chunk + 1] += chunk_offsets[chunk];
+        const size_t literal_bytes = chunk_offsets[chunk_count];
+        size_t total_size = literal_bytes;
+
+        std::vector<uint32_t> table(string_literals.size() * 2);
+        parallel_for_chunks(string_literals.size(), chunk_count, [&](size_t chunk, size_t begin, size_t end) {
+            size_t current_offset = chunk_offsets[chunk];
+            for (size_t i = begin; i < end; i++) {
+                auto&& [length, offset, data] = string_literals[i];
+                offset = current_offset;
+                current_offset += length;
+                table[i * 2] = length;
+                table[i * 2 + 1] = offset;
+            }
+            if constexpr (reversed) reverse_bytes(table.data() + begin * 2, (end - begin) * 2);
+        });
+        cursor = string_literal_offset;
+        write(reinterpret_cast<char*>(table.data()), table.size() * sizeof(uint32_t));
+
+        // alignment
+        size_t tmp = (string_literal_data_offset + total_size) % 4;
+        if (tmp != 0) total_size += 4 - tmp;
+        if (total_size > string_literal_data_size) {  // can't grow in place
+            if (string_literal_data_offset + string_literal_data_size < string_buffer.size()) {
+                // we are not at the end so we move the string value to the end of the metadata
+                // this works for the most part, but there will be a chunk of unused data in the middle
+                // to resolve that, we would have to understand all the data that is going on and move everything accordingly.
+                string_literal_data_offset = string_buffer.size();
+            } else {
+                // we are at the end of the file already, so we can just directly expand
+            }
+        }
+        string_literal_data_size = total_size;
+        // allocate once, then every literal can be copied to its final position independently
+        // the copy is split by output bytes rather than by literals, so a few big literals don't end up in the same chunk
+        grow_buffer(string_literal_data_offset + total_size);
+        const size_t copy_chunk_count = get_chunk_count(literal_bytes, 1 << 20);
+        parallel_for_chunks(literal_bytes, copy_chunk_count, [&](size_t /*chunk*/, size_t begin, size_t end) {
+            char* destination = buffer + string_literal_data_offset;
+            // last literal starting at or before begin, it might only be partially inside this chunk
+            size_t i = std::upper_bound(string_literals.begin(), string_literals.end(), begin,
+                                        [](size_t position, const string_literal_t& literal) { return position < literal.offset; }) -
+                       string_literals.begin() - 1;
+            for (; (i < string_literals.size()) && (string_literals[i].offset < end); i++) {
+                auto&& [length, offset, data] = string_literals[i];
+                const size_t first = std::max<size_t>(offset, begin);
+                const size_t last = std::min<size_t>(offset + length, end);
+                if (first < last) std::copy(data.begin() + (first - offset), data.begin() + (last - offset), destination + first);
+            }
+        });
+
+        cursor = string_literal_data_info_offset;
+        write<reversed>(string_literal_data_offset);
+        write<reversed>(string_literal_data_size);
+    }
+
+    template <bool reversed>
+    void store_delta(const std::string& path) {
+        // keep the input around, so the unchanged parts can be copied from it
+        const std::string original = string_buffer;
+        const size_t original_data_offset = string_literal_data_offset;
+        std::vector<uint32_t> original_table(string_literal_size / 4);
+        std::copy(original.begin() + string_literal_offset, original.begin() + string_literal_offset + string_literal_size,
+                  reinterpret_cast<char*>(original_table.data()));
+        if constexpr (reversed) reverse_bytes(original_table.data(), original_table.size());
+
+        store<reversed>();
+
+        delta_writer_t writer(original.data(), original.size());
+        const bool big_endian = reversed != is_big_endian_host();
+        size_t position = 0;
+        auto diff_until = [&](size_t end) {
+            if (end > position) writer.diff(position, buffer + position, end - position);
+            position = std::max(position, end);
+        };
+        auto write_table = [&]() {
+            // entries with the same length only have their offset shifted, by the same amount until the next changed length
+            size_t run_begin = 0;
+            uint32_t run_addend = 0;
+            auto flush_run = [&](size_t run_end) {
+                writer.copy_adjust(string_literal_offset + run_begin * 8, run_end - run_begin, 8, 4, run_addend, big_endian);
+            };
+            for (size_t i = 0; i < string_literals.size(); i++) {
+                auto&& [length, offset, data] = string_literals[i];
+                if (length != original_table[i * 2]) {
+                    flush_run(i);
+                    writer.add(buffer + string_literal_offset + i * 8, 8);
+                    run_begin = i + 1;
+                } else if (uint32_t(offset - original_table[i * 2 + 1]) != run_addend) {
+                    flush_run(i);
+                    run_begin = i;
+                    run_addend = offset - original_table[i * 2 + 1];
+                }
+            }
+            flush_run(string_literals.size());
+            position = string_literal_offset + string_literal_size;
+        };
+        auto write_data = [&]() {
+            // unchanged literals are copied from wherever they were in the input
+            size_t end = string_literal_data_offset;
+            for (size_t i = 0; i < string_literals.size(); i++) {
+                auto&& [length, offset, data] = string_literals[i];
+                const size_t original_position = original_data_offset + original_table[i * 2 + 1];
+                if ((length == original_table[i * 2]) &&
+                    std::equal(data.begin(), data.end(), original.begin() + original_position)) {
+                    writer.copy(original_position, length);
+                } else {
+                    writer.add(data.data(), length);
+                }
+                end = string_literal_data_offset + offset + length;
+            }
+            position = end;
+            diff_until(string_literal_data_offset + string_literal_data_size);  // alignment
+        };
+        if (string_literal_offset < string_literal_data_offset) {
+            diff_until(string_literal_offset);
+            write_table();
+            diff_until(string_literal_data_offset);
+            write_data();
+        } else {
+            diff_until(string_literal_data_offset);
+            write_data();
+            diff_until(string_literal_offset);
+            write_table();
+        }
+        diff_until(string_buffer.size());
+        writer.save(path, buffer, string_buffer.size());
+    }
+
 public:
     std::vector<string_literal_t> string_literals;
 
@@ -85,32 +263,13 @@ public:
             file.close();
             cursor = 0;
         }
-        is_reversed_order = false;
-        read(sanity);  // 0
+        read<false>(sanity);  // 0
         is_reversed_order = (sanity != 0xFAB11BAF);
         if (is_reversed_order) sanity = reverse_bytes(sanity);
         assert(sanity == 0xFAB11BAF);
 
-        read(version);                // 4
-        read(string_literal_offset);  // 8
-        read(string_literal_size);    // c
-        assert(string_literal_size % 8 == 0);
-        string_literal_data_info_offset = cursor;
-        read(string_literal_data_offset);  // 10
-        read(string_literal_data_size);    // 14
-
-        string_literals.reserve(string_literal_size / 8);
-        string_literals.resize(string_literal_size / 8);
-        cursor = string_literal_offset;
-        for (auto&& [length, offset, data] : string_literals) {
-            read(length);
-            read(offset);
-            data.resize(length);
-        }
-        for (auto&& [length, offset, data] : string_literals) {
-            cursor = string_literal_data_offset + offset;
-            read(&data[0], length);
-        }
+        if (is_reversed_order) load<true>();
+        else load<false>();
     }
 
     std::vector<size_t> search(const std::string& s) {
@@ -137,39 +296,8 @@ public:
             return;
         }
 
-        cursor = string_literal_offset;
-        size_t total_size = 0;
-        for (size_t i = 0; i < string_literals.size(); i++) {
-            auto&& [length, offset, data] = string_literals[i];
-            offset = total_size;
-            total_size += length;
-            write(length);
-            write(offset);
-        }
-
-        // alignment
-        size_t tmp = (string_literal_data_offset + total_size) % 4;
-        if (tmp != 0) total_size += 4 - tmp;
-        if (total_size > string_literal_data_size) {  // can't grow in place
-            if (string_literal_data_offset + string_literal_data_size < string_buffer.size()) {
-                // we are not at the end so we move the string value to the end of the metadata
-                // this works for the most part, but there will be a chunk of unused data in the middle
-                // to resolve that, we would have to understand all the data that is going on and move everything accordingly.
-                string_literal_data_offset = string_buffer.size();
-            } else {
-                // we are at the end of the file already, so we can just directly expand
-            }
-        }
-        string_literal_data_size = total_size;
-        cursor = string_literal_data_offset;
-        for (size_t i = 0; i < string_literals.size(); i++) {
-            auto&& [length, offset, data] = string_literals[i];
-            write(&data[0], length);
-        }
-
-        cursor = string_literal_data_info_offset;
-        write(string_literal_data_offset);
-        write(string_literal_data_size);
+        if (is_reversed_order) store<true>();
+        else store<false>();
         std::cerr << string_buffer.size() << '\n';
         file.write(buffer, string_buffer.size());
         if (!file) {
@@ -179,11 +307,104 @@ public:
         file.close();
     }
 
+    // write a delta from the input to what export_to_file would have written, see delta_patcher
+    void export_delta(const std::string& path) {
+        if (is_reversed_order) store_delta<true>(path);
+        else store_delta<false>(path);
+    }
+
+    // one literal per line: id, length and escaped data, separated by tab
+    // chunks of literals are formatted in parallel, then written in order
     void dump_to_text(std::string path) const {
-        std::ofstream f(path);
-        for (size_t i = 0; i < string_literals.size(); i++) {
-            auto&& [length, offset, data] = string_literals[i];
-            f << i << '\t' << length << '\t' << data << '\n';
+        std::ofstream f(path, std::ios::out | std::ios::binary);
+        if (!f) {
+            std::cerr << "failed to write to file: " << path << '\n';
+            return;
+        }
+        const size_t chunk_count = get_chunk_count(string_literals.size(), 1 << 14);
+        std::vector<std::string> chunks(chunk_count);
+        parallel_for_chunks(string_literals.size(), chunk_count, [&](size_t chunk, size_t begin, size_t end) {
+            std::string& out = chunks[chunk];
+            for (size_t i = begin; i < end; i++) {
+                auto&& [length, offset, data] = string_literals[i];
+                out += std::to_string(i);
+                out += '\t';
+                out += std::to_string(length);
+                out += '\t';
+                escape_literal(data, out);
+                out += '\n';
+            }
+        });
+        for (auto&& chunk : chunks) f.write(chunk.data(), chunk.size());
+        if (!f) std::cerr << "failed to write to file: " << path << '\n';
+    }
+
+    // read an edited dump_to_text output and update the literals that are different, return the number of updated literals
+    // the length column is ignored, so it doesn't have to be fixed when editing, and unchanged lines can be removed
+    size_t import_from_text(const std::string& path) {
+        std::ifstream f(path, std::ios::in | std::ios::binary);
+        if (!f) {
+            std::cerr << "failed to read file: " << path << '\n';
+            exit(-1);
+        }
+        const std::string text((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        std::vector<size_t> line_starts;
+        for (size_t position = 0; position < text.size();) {
+            line_starts.push_back(position);
+            const size_t end = text.find('\n', position);
+            position = (end == text.npos) ? text.size() : end + 1;
+        }
+        line_starts.push_back(text.size());
+        const size_t line_count = line_starts.size() - 1;
+
+        class chunk_result_t {
+        public:
+            std::vector<std::pair<size_t, std::string>> changes;
+            std::string error;
+        };
+        const size_t chunk_count = get_chunk_count(line_count, 1 << 14);
+        std::vector<chunk_result_t> results(chunk_count);
+        parallel_for_chunks(line_count, chunk_count, [&](size_t chunk, size_t begin, size_t end) {
+            auto&& [changes, error] = results[chunk];
+            std::string value;
+            for (size_t line = begin; line < end; line++) {
+                const char* first = text.data() + line_starts[line];
+                const char* last = text.data() + line_starts[line + 1];
+                // real LF and CR are always escaped, so these can only come from the line ending
+                while ((last != first) && ((last[-1] == '\n') || (last[-1] == '\r'))) last--;
+                if (first == last) continue;
+                const char* id_end = std::find(first, last, '\t');
+                const char* length_end = (id_end == last) ? last : std::find(id_end + 1, last, '\t');
+                size_t id = 0;
+                auto [id_parse_end, id_parse_error] = std::from_chars(first, id_end, id);
+                if (length_end == last) {
+                    error = "expected id, length and string separated by tab";
+                } else if ((id_parse_error != std::errc()) || (id_parse_end != id_end) || (id >= string_literals.size())) {
+                    error = "invalid id: " + std::string(first, id_end);
+                } else if (!unescape_literal(length_end + 1, last, value)) {
+                    error = "invalid escape sequence";
+                } else {
+                    if (value != string_literals[id].data) changes.emplace_back(id, value);
+                    continue;
+                }
+                error = "line " + std::to_string(line + 1) + ": " + error;
+                return;
+            }
+        });
+
+        size_t updated = 0;
+        for (auto&& [changes, error] : results) {
+            if (!error.empty()) {
+                std::cerr << "failed to import " << path << ", " << error << '\n';
+                exit(-1);
+            }
+        }
+        for (auto&& [changes, error] : results) {
+            for (auto&& [id, value] : changes) {
+                update(id, value);
+                updated++;
+            }
         }
+        return updated;
     }
 };
\ No newline at end of file
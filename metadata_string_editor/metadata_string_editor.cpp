@@ -15,42 +15,56 @@ void panic(const std::string message) {
 }
 
 int main(int argc, char** argv) {
-    std::string i, o, d, c, p;
+    std::string i, o, d, c, p, x, t;
     STRING_FROM_ARGV(i);
     STRING_FROM_ARGV(o);
     STRING_FROM_ARGV(d);
     STRING_FROM_ARGV(c);
     STRING_FROM_ARGV(p);
+    STRING_FROM_ARGV(x);
+    STRING_FROM_ARGV(t);
     if (i.empty()) {
         panic("no input file");
     }
+    if (!(p.empty() || x.empty())) {
+        panic("-x can't be used with -p, the text dump doesn't write a metadata file");
+    }
     if (!p.empty()) {
         std::cerr << "dumping original to text file: " << p << '\n';
         metadata_file_t metadata(i);
         metadata.dump_to_text(p);
         return 0;
     }
-    if (o.empty()) {
+    if (!x.empty()) {
+        std::cerr << "writing delta to " << x << " instead of the output file\n";
+    } else if (o.empty()) {
         std::cerr << "default to output file: global-metadata.dat\n";
         o = "global-metadata.dat";
     }
-    if ((d.empty()) && (c.empty())) {
-        panic("must have -d for direct substitution or -c for config exchange");
+    if ((d.empty()) && (c.empty()) && (t.empty())) {
+        panic("must have -d for direct substitution, -c for config exchange or -t for text import");
     }
-    if (!(c.empty() || d.empty())) {
-        panic("must not have both -c and -d");
+    if (int(!d.empty()) + int(!c.empty()) + int(!t.empty()) > 1) {
+        panic("must only have one of -c, -d and -t");
     }
     substitution_list_t substitution_list;
     if (!d.empty()) {
         // direct substitution
         substitution_list.parse_substitution(d);
-    } else {
+    } else if (!c.empty()) {
         const std::string old_config_file = argv[argc - 2];
         const std::string new_config_file = argv[argc - 1];
         substitution_list.parse_config_exchange(old_config_file, new_config_file);
     }
 
     metadata_file_t metadata(i);
-    substitution_list.modify(metadata);
-    metadata.export_to_file(o);
+    if (!t.empty()) {
+        std::cerr << "importing text file: " << t << '\n';
+        const size_t updated = metadata.import_from_text(t);
+        std::cerr << "updated " << updated << " string literals\n";
+    } else {
+        substitution_list.modify(metadata);
+    }
+    if (!x.empty()) metadata.export_delta(x);
+    else metadata.export_to_file(o);
 }
\ No newline at end of file
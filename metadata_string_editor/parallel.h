@@ -0,0 +1,24 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// number of chunks to split count items into, so that each chunk has at least min_chunk_size items
+// small inputs end up with 1 chunk and are processed without starting any thread
+inline size_t get_chunk_count(const size_t count, const size_t min_chunk_size) {
+    const size_t thread_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min(thread_count, count / min_chunk_size));
+}
+
+// call f(chunk, begin, end) for each of the chunk_count contiguous chunks of [0, count), one thread per chunk
+template <typename F>
+void parallel_for_chunks(const size_t count, const size_t chunk_count, const F& f) {
+    std::vector<std::thread> threads;
+    for (size_t chunk = 1; chunk < chunk_count; chunk++) {
+        threads.emplace_back(f, chunk, count * chunk / chunk_count, count * (chunk + 1) / chunk_count);
+    }
+    f(size_t(0), size_t(0), count / chunk_count);
+    for (auto&& thread : threads) thread.join();
+}
\ No newline at end of file
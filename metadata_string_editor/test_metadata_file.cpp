@@ -0,0 +1,125 @@
+// Round trip test for metadata_file_t in both byte orders.
+// Build and run: g++ -std=c++17 -pthread test_metadata_file.cpp -o test_metadata_file && ./test_metadata_file
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "metadata_file.h"
+
+static int failures = 0;
+
+static void check(bool condition, const std::string& message) {
+    if (!condition) {
+        std::cerr << "FAILED: " << message << '\n';
+        failures++;
+    }
+}
+
+static void put_u32(std::string& buffer, size_t position, uint32_t x, bool big_endian) {
+    for (size_t i = 0; i < 4; i++) buffer[position + (big_endian ? 3 - i : i)] = char((x >> (i * 8)) & 255);
+}
+
+static uint32_t get_u32(const std::string& buffer, size_t position, bool big_endian) {
+    uint32_t x = 0;
+    for (size_t i = 0; i < 4; i++) x |= uint32_t(static_cast<unsigned char>(buffer[position + (big_endian ? 3 - i : i)])) << (i * 8);
+    return x;
+}
+
+static std::string read_file(const std::string& path) {
+    std::ifstream f(path, std::ios::in | std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+}
+
+static void write_file(const std::string& path, const std::string& content) {
+    std::ofstream f(path, std::ios::out | std::ios::binary);
+    f.write(content.data(), content.size());
+}
+
+// header, (length, offset) table, literal data padded to 4 bytes, then some unrelated trailing data
+static std::string make_metadata(const std::vector<std::string>& literals, bool big_endian) {
+    const size_t table_offset = 0x20;
+    const size_t data_offset = table_offset + literals.size() * 8;
+    std::string data;
+    std::string result(data_offset, '\0');
+    put_u32(result, 0x00, 0xFAB11BAF, big_endian);
+    put_u32(result, 0x04, 24, big_endian);
+    put_u32(result, 0x08, table_offset, big_endian);
+    put_u32(result, 0x0c, literals.size() * 8, big_endian);
+    for (size_t i = 0; i < literals.size(); i++) {
+        put_u32(result, table_offset + i * 8, literals[i].size(), big_endian);
+        put_u32(result, table_offset + i * 8 + 4, data.size(), big_endian);
+        data += literals[i];
+    }
+    while (data.size() % 4) data += '\0';
+    put_u32(result, 0x10, data_offset, big_endian);
+    put_u32(result, 0x14, data.size(), big_endian);
+    return result + data + std::string(16, '\x77');
+}
+
+static void check_literals(metadata_file_t& metadata, const std::vector<std::string>& expected, const std::string& name) {
+    check(metadata.string_literals.size() == expected.size(), name + ": literal count");
+    for (size_t i = 0; (i < expected.size()) && (i < metadata.string_literals.size()); i++) {
+        check(metadata.get(i) == expected[i], name + ": literal " + std::to_string(i));
+        check(metadata.string_literals[i].length == expected[i].size(), name + ": length of literal " + std::to_string(i));
+    }
+}
+
+static void test_round_trip(bool big_endian) {
+    const std::string name = big_endian ? "big endian" : "little endian";
+    const std::filesystem::path directory = std::filesystem::temp_directory_path();
+    const std::string input_path = (directory / ("test_metadata_input_" + name + ".dat")).string();
+    const std::string unedited_path = (directory / ("test_metadata_unedited_" + name + ".dat")).string();
+    const std::string edited_path = (directory / ("test_metadata_edited_" + name + ".dat")).string();
+
+    std::vector<std::string> literals = {"https://server.old", "", "abc", std::string("a\0b\n\t\xff", 6), "RSA"};
+    const std::string input = make_metadata(literals, big_endian);
+    write_file(input_path, input);
+
+    {
+        metadata_file_t metadata(input_path);
+        check_literals(metadata, literals, name + " load");
+        metadata.export_to_file(unedited_path);
+        check(read_file(unedited_path) == input, name + ": unedited export is identical to the input");
+    }
+
+    {
+        metadata_file_t metadata(input_path);
+        literals[0] = "http://localhost:8080/a/longer/url";
+        literals[2] = "x";
+        metadata.update(0, literals[0]);
+        metadata.update(2, literals[2]);
+        metadata.export_to_file(edited_path);
+    }
+
+    const std::string edited = read_file(edited_path);
+    metadata_file_t metadata(edited_path);
+    check_literals(metadata, literals, name + " reload");
+    check(edited.compare(0, 0x10, input, 0, 0x10) == 0, name + ": sanity, version and table header are kept");
+    // the literals grew past their old space, so they are moved to the end of the file
+    check(get_u32(edited, 0x10, big_endian) == input.size(), name + ": literal data offset");
+    size_t total_size = 0;
+    for (auto&& literal : literals) total_size += literal.size();
+    check(get_u32(edited, 0x14, big_endian) == (total_size + 3) / 4 * 4, name + ": literal data size");
+    check(edited.compare(input.size() - 16, 16, std::string(16, '\x77')) == 0, name + ": trailing data is kept");
+
+    metadata.export_to_file(unedited_path);
+    check(read_file(unedited_path) == edited, name + ": exporting the edited file again is identical");
+
+    std::filesystem::remove(input_path);
+    std::filesystem::remove(unedited_path);
+    std::filesystem::remove(edited_path);
+}
+
+int main() {
+    test_round_trip(false);
+    test_round_trip(true);
+    if (failures) {
+        std::cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+    std::cerr << "all checks passed\n";
+    return 0;
+}
\ No newline at end of file
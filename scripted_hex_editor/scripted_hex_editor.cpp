@@ -2,9 +2,14 @@
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <set>
+#include <sstream>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
+#include "../delta_patcher/delta.h"
+
 std::string strip(std::string s) {
     while ((!s.empty()) && isspace(s.back())) s.pop_back();
     size_t pos = 0;
@@ -61,6 +66,368 @@ void crash(int line_id, const std::string message) {
 
 std::map<size_t, char> assign_map;
 
+// just enough of JSON to read Il2CppDumper's script.json
+class json_scanner_t {
+public:
+    const std::string& text;
+    size_t pos;
+
+    json_scanner_t(const std::string& text) : text(text), pos(0) {}
+
+    void crash(const std::string& message) const {
+        std::cerr << "Error in symbol file at byte " << pos << ": " << message << '\n';
+        exit(-1);
+    }
+
+    void skip_space() {
+        while ((pos < text.size()) && isspace(static_cast<unsigned char>(text[pos]))) pos++;
+    }
+
+    bool consume(char c) {
+        skip_space();
+        if ((pos < text.size()) && (text[pos] == c)) {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) {
+        if (!consume(c)) crash(std::string("expected ") + c);
+    }
+
+    // read into res, so the same buffer can be reused
+    void read_string(std::string& res) {
+        expect('"');
+        res.clear();
+        while (true) {
+            size_t end = pos;
+            while ((end < text.size()) && (text[end] != '"') && (text[end] != '\\')) end++;
+            res.append(text, pos, end - pos);
+            pos = end;
+            if (pos >= text.size()) crash("unclosed string");
+            char c = text[pos++];
+            if (c == '"') return;
+            if (pos >= text.size()) crash("unclosed string");
+            c = text[pos++];
+            if (c == 'n') {
+                res += '\n';
+            } else if (c == 't') {
+                res += '\t';
+            } else if (c == 'r') {
+                res += '\r';
+            } else if (c == 'b') {
+                res += '\b';
+            } else if (c == 'f') {
+                res += '\f';
+            } else if (c == 'u') {
+                // names are ASCII in practice, anything else is kept as UTF-8 of the code unit
+                if (pos + 4 > text.size()) crash("bad unicode escape");
+                size_t end = 0;
+                unsigned long code = 0;
+                try {
+                    code = stoul(text.substr(pos, 4), &end, 16);
+                } catch (...) {
+                    end = 0;
+                }
+                if (end != 4) crash("bad unicode escape");
+                pos += 4;
+                if (code < 0x80) {
+                    res += char(code);
+                } else if (code < 0x800) {
+                    res += char(0xc0 | (code >> 6));
+                    res += char(0x80 | (code & 0x3f));
+                } else {
+                    res += char(0xe0 | (code >> 12));
+                    res += char(0x80 | ((code >> 6) & 0x3f));
+                    res += char(0x80 | (code & 0x3f));
+                }
+            } else {  // '"', '\\' and '/'
+                res += c;
+            }
+        }
+    }
+
+    std::string read_string() {
+        std::string res;
+        read_string(res);
+        return res;
+    }
+
+    void skip_string() {
+        expect('"');
+        while (true) {
+            if (pos >= text.size()) crash("unclosed string");
+            char c = text[pos++];
+            if (c == '"') return;
+            if (c == '\\') pos++;
+        }
+    }
+
+    // numbers, true, false and null
+    std::string read_literal() {
+        skip_space();
+        size_t start = pos;
+        while ((pos < text.size()) && (isalnum(static_cast<unsigned char>(text[pos])) || (text[pos] == '-') ||
+                                       (text[pos] == '+') || (text[pos] == '.'))) {
+            pos++;
+        }
+        if (start == pos) crash("unexpected character");
+        return text.substr(start, pos - start);
+    }
+
+    void skip_value() {
+        if (consume('{')) {
+            if (consume('}')) return;
+            do {
+                skip_string();
+                expect(':');
+                skip_value();
+            } while (consume(','));
+            expect('}');
+        } else if (consume('[')) {
+            if (consume(']')) return;
+            do {
+                skip_value();
+            } while (consume(','));
+            expect(']');
+        } else if ((pos < text.size()) && (text[pos] == '"')) {  // consume() already skipped the spaces
+            skip_string();
+        } else {
+            read_literal();
+        }
+    }
+};
+
+class symbol_table_t {
+private:
+    class load_segment_t {
+    public:
+        size_t file_offset;
+        size_t virtual_address;
+        size_t file_size;
+    };
+
+    std::map<std::string, size_t> symbols;  // name -> virtual address
+    std::set<std::string> ambiguous_symbols;  // names defined more than once with different addresses
+    std::unordered_set<std::string> used_names;  // only the names used by the script are kept
+    std::vector<load_segment_t> segments;
+
+    static size_t read_le(const std::string& buffer, size_t pos, size_t size) {
+        size_t result = 0;
+        for (size_t i = 0; i < size; i++) result |= size_t(static_cast<unsigned char>(buffer[pos + i])) << (i * 8);
+        return result;
+    }
+
+public:
+    // read the PT_LOAD program headers of an ELF so virtual addresses can be turned into file offsets
+    // non-ELF input is fine, in which case virtual addresses are used as file offsets
+    void load_elf(const std::string& file) {
+        std::fstream f(file, std::ios::in | std::ios::binary);
+        f.seekg(0, f.end);
+        const size_t file_size = f.tellg();
+        f.seekg(0, f.beg);
+        std::string header(0x40, 0);
+        f.read(&header[0], header.size());
+        if ((!f) || (header.substr(0, 4) != "\x7f" "ELF")) return;
+        const bool is_64 = header[4] == 2;
+        if (header[5] != 1) {
+            std::cerr << "Warning: big endian ELF is not supported, symbols will be used as file offsets\n";
+            return;
+        }
+        const size_t phoff = is_64 ? read_le(header, 0x20, 8) : read_le(header, 0x1c, 4);
+        const size_t phentsize = read_le(header, is_64 ? 0x36 : 0x2a, 2);
+        const size_t phnum = read_le(header, is_64 ? 0x38 : 0x2c, 2);
+        if ((phentsize < (is_64 ? 0x38u : 0x20u)) || (phoff > file_size) || (phentsize * phnum > file_size - phoff)) {
+            std::cerr << "Error in reading ELF program headers, the ELF header is corrupted!\n";
+            exit(-1);
+        }
+        std::string table(phentsize * phnum, 0);
+        f.seekg(phoff, f.beg);
+        f.read(&table[0], table.size());
+        if (!f) {
+            std::cerr << "Error in reading ELF program headers!\n";
+            exit(-1);
+        }
+        for (size_t i = 0; i < phnum; i++) {
+            const size_t entry = i * phentsize;
+            if (read_le(table, entry, 4) != 1) continue;  // PT_LOAD
+            load_segment_t segment;
+            if (is_64) {
+                segment.file_offset = read_le(table, entry + 0x08, 8);
+                segment.virtual_address = read_le(table, entry + 0x10, 8);
+                segment.file_size = read_le(table, entry + 0x20, 8);
+            } else {
+                segment.file_offset = read_le(table, entry + 0x04, 4);
+                segment.virtual_address = read_le(table, entry + 0x08, 4);
+                segment.file_size = read_le(table, entry + 0x10, 4);
+            }
+            segments.push_back(segment);
+        }
+    }
+
+    void add_symbol(const std::string& name, size_t address) {
+        if (!used_names.count(name)) return;
+        auto it = symbols.find(name);
+        if ((it != symbols.end()) && (it->second != address)) ambiguous_symbols.insert(name);
+        symbols[name] = address;
+    }
+
+    // one symbol per line: <hex virtual address> <name>
+    void load_symbol_lines(const std::string& text) {
+        std::stringstream f(text);
+        std::string line;
+        for (int line_id = 1; std::getline(f, line); line_id++) {
+            size_t pos = line.find("#");
+            if (pos != line.npos) line = line.substr(0, pos);
+            std::stringstream ss(line);
+            std::string address, name;
+            if (!(ss >> address >> name)) continue;
+            size_t end = 0;
+            size_t value = 0;
+            try {
+                value = stoull(address, &end, 16);
+            } catch (...) {
+                end = 0;
+            }
+            if (end != address.size()) {
+                std::cerr << "Error in symbol file at line " << line_id << ": bad address: " << address << '\n';
+                exit(-1);
+            }
+            add_symbol(name, value);
+        }
+    }
+
+    // Il2CppDumper's script.json, only the ScriptMethod entries are used
+    // "Address" is the RVA, which is the same as the virtual address for libil2cpp.so
+    // "Name" is <type>$$<method>, it's also added with "$$" and '.' replaced by '_', like the names in the notes:
+    // TitleDM$$IsHoldingTestModePeriod -> TitleDM_IsHoldingTestModePeriod, HomeDM_DailyTheaterButtonVO$$.ctor -> HomeDM_DailyTheaterButtonVO__ctor
+    // overloads share the same name, so in file order the second one get "_1", the third one "_2", ...: HomeDM_DailyTheaterButtonVO__ctor_1
+    void load_script_json(const std::string& text) {
+        json_scanner_t json(text);
+        std::map<std::string, size_t> alias_count;
+        std::string key, name, address, alias;
+        json.expect('{');
+        if (json.consume('}')) return;
+        do {
+            json.read_string(key);
+            json.expect(':');
+            if (key != "ScriptMethod") {
+                json.skip_value();
+                continue;
+            }
+            json.expect('[');
+            if (json.consume(']')) continue;
+            do {
+                name.clear();
+                address.clear();
+                json.expect('{');
+                if (!json.consume('}')) {
+                    do {
+                        json.read_string(key);
+                        json.expect(':');
+                        if (key == "Name") json.read_string(name);
+                        else if (key == "Address") address = json.read_literal();
+                        else json.skip_value();
+                    } while (json.consume(','));
+                    json.expect('}');
+                }
+                size_t end = 0;
+                size_t value = 0;
+                try {
+                    value = stoull(address, &end);
+                } catch (...) {
+                    end = 0;
+                }
+                if (name.empty() || address.empty() || (end != address.size())) json.crash("ScriptMethod without valid Name and Address");
+                add_symbol(name, value);
+                alias.clear();
+                for (size_t pos = 0; pos < name.size(); pos++) {
+                    if ((name[pos] == '$') && (pos + 1 < name.size()) && (name[pos + 1] == '$')) {
+                        alias += '_';
+                        pos++;
+                    } else {
+                        alias += (name[pos] == '.') ? '_' : name[pos];
+                    }
+                }
+                // overloads are only counted for the aliases used by the script, see use_names()
+                if (!used_names.count(alias)) continue;
+                const size_t overload = alias_count[alias]++;
+                if (overload) alias += "_" + std::to_string(overload);
+                if (alias != name) add_symbol(alias, value);
+            } while (json.consume(','));
+            json.expect(']');
+        } while (json.consume(','));
+        json.expect('}');
+    }
+
+    // either a script.json from Il2CppDumper or a text file with one <hex virtual address> <name> per line
+    // collect the names in the addresses of the script, so only these are kept when loading the symbol file
+    // for a name that can be an overload suffix (Foo_1), the name without the suffix is needed to count the overloads
+    void use_names(const std::string& commands) {
+        for (auto&& line : split(commands, "\n")) {
+            for (auto&& command : split(line.substr(0, line.find("#")), ";")) {
+                std::string address = strip(command.substr(0, command.find('=')));
+                if ((!address.empty()) && (address[0] == '[')) address = address.substr(1);
+                if ((!address.empty()) && (address.back() == ']')) address.pop_back();
+                for (auto&& item : split(address, ",")) {
+                    for (auto&& part : split(item, "..")) {
+                        const std::string name = strip(part.substr(0, part.find('+')));
+                        if (name.empty()) continue;
+                        used_names.insert(name);
+                        size_t pos = name.find_last_not_of("0123456789");
+                        if ((pos != name.npos) && (pos + 1 < name.size()) && (name[pos] == '_')) used_names.insert(name.substr(0, pos));
+                    }
+                }
+            }
+        }
+    }
+
+    void load_symbols(const std::string& file) {
+        std::fstream f(file, std::ios::in | std::ios::binary);
+        if (!f) {
+            std::cerr << "Error in reading symbol file!\n";
+            exit(-1);
+        }
+        f.seekg(0, f.end);
+        std::string text(f.tellg(), '\0');
+        f.seekg(0, f.beg);
+        f.read(&text[0], text.size());
+        if (!f) {
+            std::cerr << "Error in reading symbol file!\n";
+            exit(-1);
+        }
+        const size_t first = text.find_first_not_of(" \t\r\n");
+        if ((first != text.npos) && (text[first] == '{')) load_script_json(text);
+        else load_symbol_lines(text);
+        std::cerr << "Loaded " << symbols.size() << " symbols used by the script";
+        if (!ambiguous_symbols.empty()) std::cerr << ", " << ambiguous_symbols.size() << " of them are ambiguous";
+        std::cerr << '\n';
+    }
+
+    bool contains(const std::string& name) const { return symbols.count(name) != 0; }
+
+    bool is_ambiguous(const std::string& name) const { return ambiguous_symbols.count(name) != 0; }
+
+    // turn the symbol into a file offset, return false if the input is an ELF and the symbol isn't in any of its segments
+    bool resolve(const std::string& name, size_t& result) const {
+        const size_t address = symbols.at(name);
+        if (segments.empty()) {
+            result = address;
+            return true;
+        }
+        for (auto&& [file_offset, virtual_address, file_size] : segments) {
+            if ((virtual_address <= address) && (address < virtual_address + file_size)) {
+                result = address - virtual_address + file_offset;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+symbol_table_t symbol_table;
+
 void assign(size_t address, char byte) {
     if (assign_map.count(address)) {
         std::cerr << "Warning: address " << to_hex(address) << " is overwritten twice, " << byte_to_hex(assign_map[address])
@@ -146,7 +513,37 @@ public:
 
     void crash(std::string message) const { ::crash(line_id, message); }
 
-    size_t read_address(std::string& s) const { return stoull(s, nullptr, 16); }
+    // plain hex value, returns false if s isn't one
+    static bool read_hex(const std::string& s, size_t& value) {
+        if (s.empty() || !isxdigit(static_cast<unsigned char>(s[0]))) return false;
+        size_t end = 0;
+        try {
+            value = stoull(s, &end, 16);
+        } catch (...) {
+            return false;
+        }
+        return end == s.size();
+    }
+
+    size_t read_address(std::string s) const {
+        // either a hex address or symbol, with an optional hex offset: [TitleDM_IsHoldingTestModePeriod+0x8]
+        s = strip(s);
+        size_t offset = 0;
+        size_t pos = s.find('+');
+        if (pos != s.npos) {
+            if (!read_hex(strip(s.substr(pos + 1)), offset)) crash("bad offset (must be hex): " + s.substr(pos + 1));
+            s = strip(s.substr(0, pos));
+        }
+        if (symbol_table.is_ambiguous(s)) crash("ambiguous symbol (defined more than once with different addresses): " + s);
+        if (symbol_table.contains(s)) {
+            size_t address = 0;
+            if (!symbol_table.resolve(s, address)) crash("symbol is not inside any loaded segment of the input: " + s);
+            return address + offset;
+        }
+        size_t address = 0;
+        if (!read_hex(s, address)) crash("unknown symbol or bad address: " + s);
+        return address + offset;
+    }
 
     address_t(const int line_id, std::string s) : line_id(line_id) {
         s = strip(s);
@@ -236,7 +633,7 @@ std::string read_text(std::string file) {
     }
     return content;
 }
-void write_output(std::string in, std::string out) {
+void write_output(std::string in, std::string out, std::string delta) {
     char* buffer = nullptr;
     size_t length = 0;
     {
@@ -256,10 +653,24 @@ void write_output(std::string in, std::string out) {
         }
         f.close();
     }
+    const std::string original = delta.empty() ? "" : std::string(buffer, length);
     for (auto&& [address, byte] : assign_map) {
         assert(address < length);
         buffer[address] = byte;
     }
+    if (!delta.empty()) {
+        // only the assigned bytes are stored, everything in between is copied from the input
+        delta_writer_t writer(original.data(), length);
+        size_t position = 0;
+        for (auto&& [address, byte] : assign_map) {
+            writer.copy(position, address - position);
+            writer.add(&buffer[address], 1);
+            position = address + 1;
+        }
+        writer.copy(position, length - position);
+        writer.save(delta, buffer, length);
+        return;
+    }
     {
         std::fstream f(out, std::ios::out | std::ios::binary);
         if (!f) {
@@ -277,27 +688,33 @@ void write_output(std::string in, std::string out) {
     }
 
 int main(int argc, char** argv) {
-    std::string i, o, s, c;
+    std::string i, o, s, c, m, x;
     STRING_FROM_ARGV(i);
     STRING_FROM_ARGV(o);
     STRING_FROM_ARGV(s);
     STRING_FROM_ARGV(c);
+    STRING_FROM_ARGV(m);
+    STRING_FROM_ARGV(x);
     if (i.empty()) {
         std::cerr << "No input file provided!";
         return -1;
     }
-    if (o.empty()) {
+    if (!x.empty()) {
+        std::cerr << "Writing delta to " << x << " instead of the output file\n";
+    } else if (o.empty()) {
         std::cerr << "No output file provided, writing to input file!\n";
         o = i;
     }
-    if (s.empty()) {
-        if (c.empty()) {
-            std::cerr << "No script of command provided, use -s or -c";
-            return -1;
-        }
-        parse_commands(c);
-    } else {
-        parse_commands(read_text(s));
+    if (s.empty() && c.empty()) {
+        std::cerr << "No script of command provided, use -s or -c";
+        return -1;
+    }
+    const std::string commands = s.empty() ? c : read_text(s);
+    if (!m.empty()) {
+        symbol_table.use_names(commands);
+        symbol_table.load_elf(i);
+        symbol_table.load_symbols(m);
     }
-    write_output(i, o);
+    parse_commands(commands);
+    write_output(i, o, x);
 }
\ No newline at end of file